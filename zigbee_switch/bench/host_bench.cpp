@@ -0,0 +1,96 @@
+/**
+ * @brief 主机基准测试: 在Linux上编译 light_math.h，校验结果和耗时
+ *
+ * 用例、输入序列和计时方式来自 bench_cases.h，与固件 BENCHMARK_MODE 相同，
+ * 计数单位为主机时间戳周期。
+ */
+
+#include <stdio.h>
+
+#include "bench_cases.h"
+
+// 耗时上限: 单次调用 p50 不超过 baseline p50 的倍数 (按当前实现留有余量)
+const uint32_t BUDGET_SERVO_ANGLE_TO_DUTY = 4;
+const uint32_t BUDGET_SCALE_RGB = 6;
+const uint32_t BUDGET_TEMP_TO_RGB = 12;
+const int BENCH_ATTEMPTS = 3;  // 超出上限时重测次数，排除主机调度抖动
+
+static int failures = 0;
+static uint32_t baselineP50 = 1;
+
+BenchStats benchRun(const char *name, void (*fn)(int)) {
+  BenchStats stats = benchMeasure(fn, BENCH_ITERATIONS);
+  printf("[Bench] %-16s n=%5d p50=%8u p99=%8u max=%8u\n",
+         name, BENCH_ITERATIONS, stats.p50, stats.p99, stats.max);
+  return stats;
+}
+
+// 取多次测量中最好的一次与上限比较，算法退化 (如逐次除法、浮点换算) 时失败
+void benchCheck(const char *name, void (*fn)(int), uint32_t budget) {
+  uint32_t best = UINT32_MAX;
+  for (int attempt = 0; attempt < BENCH_ATTEMPTS && best > baselineP50 * budget; attempt++) {
+    BenchStats stats = benchRun(name, fn);
+    if (stats.p50 < best) best = stats.p50;
+  }
+  if (best > baselineP50 * budget) {
+    printf("FAIL %s: p50 %u > %u x baseline (%u)\n", name, best, budget, baselineP50);
+    failures++;
+  }
+}
+
+void expectColor(const char *what, RgbColor got, uint8_t r, uint8_t g, uint8_t b) {
+  if (got.r == r && got.g == g && got.b == b) return;
+  printf("FAIL %s: got (%d,%d,%d), expected (%d,%d,%d)\n", what, got.r, got.g, got.b, r, g, b);
+  failures++;
+}
+
+void expectInt(const char *what, long got, long expected) {
+  if (got == expected) return;
+  printf("FAIL %s: got %ld, expected %ld\n", what, got, expected);
+  failures++;
+}
+
+// 固定输入的期望值，算法改动导致结果变化时失败
+void checkResults() {
+  expectInt("servoAngleToDuty(0)", servoAngleToDuty(0, SERVO_DUTY_MIN, SERVO_DUTY_MAX), 205);
+  expectInt("servoAngleToDuty(90)", servoAngleToDuty(90, SERVO_DUTY_MIN, SERVO_DUTY_MAX), 614);
+  expectInt("servoAngleToDuty(180)", servoAngleToDuty(180, SERVO_DUTY_MIN, SERVO_DUTY_MAX), 1024);
+  expectInt("kelvinToMireds(6500)", kelvinToMireds(6500), 153);
+  expectInt("kelvinToMireds(2000)", kelvinToMireds(2000), 500);
+
+  expectColor("scaleRgb full", scaleRgb(255, 128, 0, 255), 255, 128, 0);
+  expectColor("scaleRgb half", scaleRgb(200, 100, 50, 128), 100, 50, 25);
+  expectColor("scaleRgb off", scaleRgb(255, 255, 255, 0), 0, 0, 0);
+  expectColor("tempToRgb 2000K", tempToRgb(255, 500), 255, 255, 0);
+  expectColor("tempToRgb 6500K", tempToRgb(255, 153), 0, 0, 255);
+  expectColor("tempToRgb 4000K half", tempToRgb(128, 250), 71, 71, 56);
+
+  // 色温越高越冷: 冷分量单调不减，暖分量单调不增
+  RgbColor prev = tempToRgb(255, 500);
+  for (int mireds = 499; mireds >= 153; mireds--) {
+    RgbColor c = tempToRgb(255, mireds);
+    if (c.b < prev.b || c.r > prev.r) {
+      printf("FAIL tempToRgb not monotonic at %d mireds\n", mireds);
+      failures++;
+      break;
+    }
+    prev = c;
+  }
+}
+
+int main() {
+  checkResults();
+
+  baselineP50 = benchRun("baseline", benchBaseline).p50;
+  if (baselineP50 == 0) baselineP50 = 1;
+  benchCheck("servoAngleToDuty", benchServoAngleToDuty, BUDGET_SERVO_ANGLE_TO_DUTY);
+  benchCheck("scaleRgb", benchScaleRgb, BUDGET_SCALE_RGB);
+  benchCheck("tempToRgb", benchTempToRgb, BUDGET_TEMP_TO_RGB);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,19 @@
+/**
+ * @brief esp_cpu.h 主机桩: 用主机时间戳计数器代替CPU周期计数
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint32_t esp_cpu_get_cycle_count() {
+  return (uint32_t)__rdtsc();
+}
+#else
+#include <chrono>
+inline uint32_t esp_cpu_get_cycle_count() {
+  return (uint32_t)std::chrono::steady_clock::now().time_since_epoch().count();
+}
+#endif
@@ -0,0 +1,47 @@
+/**
+ * @brief 纯计算基准测试用例
+ *
+ * 主程序 (BENCHMARK_MODE) 和主机基准测试 (bench/) 共用同一组输入序列和计时方式，
+ * 两边的结果才有可比性。
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "bench_stats.h"
+#include "esp_cpu.h"
+#include "light_math.h"
+
+const int BENCH_ITERATIONS = 2000;  // 每个函数的采样次数
+const int BENCH_BATCH = 16;         // 每次采样连续调用次数，摊薄计时本身的开销
+
+static uint32_t benchSamples[BENCH_ITERATIONS];
+static volatile uint32_t benchSink;  // 保存计算结果，防止被优化掉
+
+// 基准用例: 一次整数乘加，作为主机相对阈值的单位
+inline void benchBaseline(int i) { benchSink = i * 3 + 1; }
+
+inline void benchServoAngleToDuty(int i) { benchSink = servoAngleToDuty(i % 181, SERVO_DUTY_MIN, SERVO_DUTY_MAX); }
+
+inline void benchScaleRgb(int i) {
+  RgbColor c = scaleRgb(i & 0xFF, (i >> 2) & 0xFF, (i >> 4) & 0xFF, i & 0xFF);
+  benchSink = c.r | (c.g << 8) | (c.b << 16);
+}
+
+inline void benchTempToRgb(int i) {
+  RgbColor c = tempToRgb(i & 0xFF, 153 + (i % 348));
+  benchSink = c.r | (c.g << 8) | (c.b << 16);
+}
+
+// 每个采样连续调用 fn BENCH_BATCH 次，返回单次调用的 p50/p99/max
+inline BenchStats benchMeasure(void (*fn)(int), int count) {
+  for (int i = 0; i < count; i++) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int j = 0; j < BENCH_BATCH; j++) {
+      fn(i * BENCH_BATCH + j);
+    }
+    benchSamples[i] = (esp_cpu_get_cycle_count() - start) / BENCH_BATCH;
+  }
+  return benchStats(benchSamples, count);
+}
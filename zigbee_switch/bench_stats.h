@@ -0,0 +1,22 @@
+/**
+ * @brief 基准测试统计 (p50/p99/max)
+ *
+ * 主程序 (BENCHMARK_MODE) 和主机基准测试 (bench/) 共用。
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+struct BenchStats {
+  uint32_t p50;
+  uint32_t p99;
+  uint32_t max;
+};
+
+// 原地排序采样并返回统计结果
+inline BenchStats benchStats(uint32_t *samples, int count) {
+  std::sort(samples, samples + count);
+  return { samples[count / 2], samples[(count * 99) / 100], samples[count - 1] };
+}
@@ -0,0 +1,57 @@
+/**
+ * @brief 灯光/舵机纯计算函数
+ *
+ * 不依赖Arduino和ESP-IDF，供主程序调用，也可在Linux主机上编译做基准测试
+ * (见 bench/)。
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+struct RgbColor {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+inline uint16_t kelvinToMireds(uint16_t kelvin) {
+  return 1000000 / kelvin;
+}
+
+inline uint16_t miredsToKelvin(uint16_t mireds) {
+  return 1000000 / mireds;
+}
+
+// 与Arduino map()相同的整数线性映射
+inline long mapRange(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+inline long clampRange(long x, long lo, long hi) {
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+
+// 舵机占空比范围 (13位分辨率，50Hz)，主程序和主机基准测试共用
+const int SERVO_DUTY_MIN = 205;   // 0度对应的duty (约0.5ms脉宽)
+const int SERVO_DUTY_MAX = 1024;  // 180度对应的duty (约2.5ms脉宽)
+
+// 舵机角度 (0-180°) 转LEDC占空比
+inline int servoAngleToDuty(int angle, int dutyMin, int dutyMax) {
+  return dutyMin + (angle * (dutyMax - dutyMin) / 180);
+}
+
+// RGB按亮度缩放
+inline RgbColor scaleRgb(uint8_t r, uint8_t g, uint8_t b, uint8_t level) {
+  float brightness = (float)level / 255.0f;
+  return { (uint8_t)(r * brightness), (uint8_t)(g * brightness), (uint8_t)(b * brightness) };
+}
+
+// 色温 (mireds) 转LED颜色: 2000K偏暖 (红绿)，6500K偏冷 (蓝)
+inline RgbColor tempToRgb(uint8_t level, uint16_t mireds) {
+  float brightness = (float)level / 255.0f;
+  uint16_t kelvin = miredsToKelvin(mireds);
+  uint8_t warm = clampRange(mapRange(kelvin, 2000, 6500, 255, 0), 0, 255);
+  uint8_t cold = clampRange(mapRange(kelvin, 2000, 6500, 0, 255), 0, 255);
+  return { (uint8_t)(warm * brightness), (uint8_t)(warm * brightness), (uint8_t)(cold * brightness) };
+}
@@ -21,26 +21,51 @@
  * - Pairing timeout with deep sleep
  * - LED status indication during pairing
  * - Servo auto-return after timeout
+ * - Optional On/Off client endpoint: button drives bound lights/groups directly
+ * - Optional on-target cycle benchmark of hot handlers (BENCHMARK_MODE)
+ * - Lock-free light state mirror (seqlock) shared by callbacks and loop
+ * - Zero-touch commissioning from a manufacturing NVS partition
+ *   (install code + channel mask)
+ * - Local weekly schedule (NVS) driven by time synced from the coordinator
+ * - Servo supply-current sensing: press-angle calibration and press confirmation
+ * - Optional battery mode: deep sleep between button/heartbeat/schedule wakeups
  */
 
 #ifndef ZIGBEE_MODE_ED
 #error "Zigbee end device mode is not selected in Tools->Zigbee mode"
 #endif
 
+#include "Preferences.h"
 #include "Zigbee.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#include "esp_cpu.h"
 #include "esp_sleep.h"
 #include "esp_timer.h"
 #include "esp_zigbee_core.h"
+#include "light_math.h"
+#ifdef BENCHMARK_MODE
+#include "bench_cases.h"
+#endif
+#include <sys/time.h>
+#include <time.h>
 
 /********************* Configuration **************************/
 #define ZIGBEE_RGB_LIGHT_ENDPOINT 10
+#define ZIGBEE_SWITCH_ENDPOINT    11
+#define ZIGBEE_PRESS_ENDPOINT     12
+
+// 直连绑定: 按键直接向绑定的设备/组发送 On/Off 命令，不经过协调器自动化
+const bool DIRECT_BINDING_ENABLED = true;
+
+// 基准测试: 启用后在setup()末尾测量各处理函数的CPU周期数
+// #define BENCHMARK_MODE
 
 // Hardware pins
 const uint8_t LED_PIN = RGB_BUILTIN;
 const uint8_t BUTTON_PIN = BOOT_PIN;
 const uint8_t SERVO_PIN = 5;
+const uint8_t SERVO_SENSE_PIN = 4;                   // 舵机电流采样 (ADC，接分流电阻)
 
 // Timing configuration
 const unsigned long PAIRING_TIMEOUT_MS = 40000;      // 配网超时时间 (40秒)
@@ -49,18 +74,55 @@ const unsigned long LED_SLOW_BLINK_MS = 500;         // 慢速闪烁间隔
 const unsigned long LONG_PRESS_MS = 3000;            // 长按时间 (3秒)
 const unsigned long DEBOUNCE_MS = 100;               // 按键消抖时间
 
+// 量产配网 (zero-touch): 从工厂NVS分区读取安装码和信道掩码
+const char *MFG_NVS_PARTITION = "fctry";             // 工厂NVS分区名
+const char *MFG_NVS_NAMESPACE = "zb_mfg";            // 命名空间
+const unsigned long PROVISIONED_PAIRING_TIMEOUT_MS = 300000;  // 已预配置设备的配网超时 (5分钟)
+const unsigned long PROVISIONED_RETRY_SLEEP_MS = 600000;      // 配网失败后定时唤醒重试 (10分钟)
+
 // Servo configuration
 #define LEDC_TIMER              LEDC_TIMER_0
 #define LEDC_MODE               LEDC_LOW_SPEED_MODE
 #define LEDC_CHANNEL            LEDC_CHANNEL_0
 #define LEDC_DUTY_RES           LEDC_TIMER_13_BIT
 #define LEDC_FREQUENCY          50                   // 50Hz for servo
-const int SERVO_DUTY_MIN = 205;                      // 0度对应的duty
-const int SERVO_DUTY_MAX = 1024;                     // 180度对应的duty
+// SERVO_DUTY_MIN / SERVO_DUTY_MAX 定义在 light_math.h (与主机基准测试共用)
 const int SERVO_TARGET_ANGLE = 160;                  // 目标角度
 const int SERVO_REST_ANGLE = 20;                     // 休息角度
 const unsigned long SERVO_AUTO_RETURN_MS = 2000;     // 自动回位时间 (2秒)
 
+// Servo current sensing (舵机地线串联分流电阻，电压接SERVO_SENSE_PIN)
+const bool SERVO_SENSE_ENABLED = true;               // 关闭后退回开环 (固定SERVO_TARGET_ANGLE)
+const uint32_t SERVO_SHUNT_MILLIOHM = 1000;          // 分流电阻 (1Ω: 1mV = 1mA)
+const uint32_t SERVO_CONTACT_CURRENT_MA = 150;       // 高于空载基线该值视为压到开关
+const int SERVO_SENSE_SAMPLES = 8;                   // 每次采样平均次数
+const unsigned long SERVO_SETTLE_MS = 500;           // 上电回位后等待时间
+const int SERVO_CALIB_STEP_DEG = 5;                  // 校准扫描步进
+const unsigned long SERVO_CALIB_SETTLE_MS = 150;     // 校准每步等待时间
+const int SERVO_PRESS_MARGIN_DEG = 5;                // 检测到接触后额外行程
+const unsigned long SERVO_CONFIRM_DELAY_MS = 300;    // 按压后延时采样确认
+const int SERVO_MAX_RETRIES = 2;                     // 未确认时最多重试次数
+const int SERVO_RETRY_STEP_DEG = 10;                 // 每次重试增加的角度
+
+// Battery mode: 事件之间深度睡眠，按键/心跳/定时唤醒后重连、执行、批量上报再睡眠
+const bool BATTERY_MODE = false;
+const unsigned long BATTERY_HEARTBEAT_MS = 3600000;  // 心跳唤醒间隔 (1小时)
+const unsigned long BATTERY_AWAKE_WINDOW_MS = 8000;  // 单次唤醒最长时间
+const unsigned long BATTERY_FIRST_JOIN_AWAKE_MS = 30000; // 首次入网后保持唤醒 (协调器查询设备、配置绑定和报告)
+const unsigned long BATTERY_JOIN_TIMEOUT_MS = 5000;  // Zigbee.begin()重连超时
+const unsigned long BATTERY_SCHEDULE_LEAD_MS = 3000; // 定时条目提前唤醒 (覆盖启动和重连)
+const uint32_t BATTERY_ACTIVE_CURRENT_UA = 25000;    // 唤醒时平均电流 (估算用，不含舵机)
+const uint32_t BATTERY_SLEEP_CURRENT_UA = 10;        // 深度睡眠电流 (估算用)
+
+// Local schedule configuration
+const unsigned long TIME_RESYNC_MS = 24UL * 3600 * 1000;  // 时间重新同步间隔 (24小时)
+const unsigned long TIME_RETRY_MS = 60000;           // 同步失败重试间隔 (60秒)
+const unsigned long TIME_DST_TIMEOUT_MS = 2000;      // 读取夏令时属性的等待时间
+const int SCHEDULE_MAX_ENTRIES = 16;                 // 定时表最大条目数
+const uint16_t SCHEDULE_CLUSTER_ID = 0xFC00;         // 定时表私有cluster (厂商自定义范围)
+const uint16_t SCHEDULE_ATTR_TABLE_ID = 0x0000;      // 定时表属性 (octet string，每条4字节)
+const uint32_t ZCL_TIME_EPOCH_OFFSET = 946684800;    // ZCL时间 (2000-01-01) 与Unix时间之差
+
 // Default light settings
 const uint8_t DEFAULT_BRIGHTNESS = 255;
 const uint8_t DEFAULT_RED = 255;
@@ -92,21 +154,136 @@ struct DeviceState {
   .ledBlinkOn = false
 };
 
+enum LightColorMode {
+  LIGHT_MODE_RGB,         // RGB (X/Y) 模式
+  LIGHT_MODE_TEMP         // 色温模式
+};
+
+enum ScheduleAction {
+  SCHEDULE_ACTION_OFF,
+  SCHEDULE_ACTION_ON,
+  SCHEDULE_ACTION_TOGGLE
+};
+
+// 定时表条目 (4字节)，时间为协调器时区的本地时间
+struct ScheduleEntry {
+  uint8_t days;           // bit0=周日 ... bit6=周六
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t action;         // ScheduleAction
+};
+
+// 电池模式统计和跨睡眠状态 (RTC内存，深度睡眠后保留)
+struct BatteryState {
+  bool joined;                // 曾经入网，唤醒后只需重连
+  bool reportPending;         // 有未发出的状态上报 (失败时下次唤醒补发)
+  uint32_t wakeCount;
+  uint64_t awakeMsTotal;
+  uint64_t sleepMsTotal;
+  int64_t sleepEnterUs;       // 进入睡眠时的系统时间 (RTC计时，跨睡眠连续)
+  uint32_t lastLatencyMs;     // 按键唤醒到上报发出
+  uint32_t maxLatencyMs;
+};
+
+// 工厂预配置数据 (来自MFG_NVS_PARTITION)
+struct CommissioningConfig {
+  bool provisioned;       // 存在任一预配置项
+  bool hasInstallCode;
+  uint8_t installCodeType;  // ESP_ZB_IC_TYPE_xx
+  uint8_t installCode[18];  // 安装码 + 2字节CRC
+  uint32_t channelMask;     // 0 表示使用默认信道
+} commissioning = {};
+
+// 灯光状态快照 (loop侧读取的副本)
+struct LightSnapshot {
+  bool on;
+  uint8_t level;
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+  uint8_t colorMode;      // LightColorMode
+  uint16_t mireds;
+};
+
+// 灯光状态镜像: Zigbee回调通过seqlock写入，loop无锁读取
+// seq为奇数表示写入中；整体对齐到一个cache line
+struct alignas(32) LightMirror {
+  uint32_t seq;
+  LightSnapshot data;
+};
+
+static LightMirror lightMirror = {};
+static portMUX_TYPE lightMirrorWriteLock = portMUX_INITIALIZER_UNLOCKED;  // 仅串行化写入方
+
 // Servo timer handle
 static esp_timer_handle_t servoTimer = NULL;
 static volatile bool servoAutoReturnPending = false;  // 定时器触发标志
 static bool internalStateChange = false;              // 内部状态变更标志，防止回调干扰
 
-ZigbeeColorDimmableLight zbLight(ZIGBEE_RGB_LIGHT_ENDPOINT);
+// Servo sensing state
+static esp_timer_handle_t servoConfirmTimer = NULL;
+static volatile bool servoConfirmPending = false;     // 定时器触发标志
+static int servoPressAngle = SERVO_TARGET_ANGLE;      // 校准后的按压角度
+static int servoPlayAngle = SERVO_TARGET_ANGLE;       // 本次按压的角度 (含重试)
+static int servoRetryCount = 0;
+RTC_DATA_ATTR static uint32_t servoBaselineMa = 0;    // 静止时的空载电流 (深度睡眠后保留)
+RTC_DATA_ATTR static bool servoBaselineValid = false; // 基线已测量 (空载电流可能读到0，不能用0判断)
+static bool pressConfirmed = false;
+
+// Battery mode state
+RTC_DATA_ATTR static BatteryState battery = {};
+static ButtonAction batteryWakeAction = BUTTON_NONE;  // 唤醒按键动作 (短按连接后执行，长按立即执行)
+static bool batteryOffline = false;                   // 本次唤醒重连失败: 离线执行按键/定时，上报留到下次唤醒
+static unsigned long batteryFirstJoinMs = 0;          // 本次启动首次入网的时间，0表示非首次入网
+static unsigned long batteryWindowStartMs = 0;        // 唤醒窗口起点 (首次入网时从保持唤醒结束算起)
+static bool batteryPressReportPending = false;
+
+// Schedule timer handle
+static esp_timer_handle_t scheduleTimer = NULL;
+static volatile bool schedulePending = false;         // 定时器触发标志
+static ScheduleEntry scheduleTable[SCHEDULE_MAX_ENTRIES];
+static int scheduleCount = 0;
+static int scheduleNextIndex = -1;                    // 已设定时器对应的条目
+RTC_DATA_ATTR static bool timeSynced = false;         // 系统时间由RTC保持，深度睡眠后仍有效
+RTC_DATA_ATTR static int32_t timezoneOffset = 0;      // 协调器时区偏移 (秒)
+RTC_DATA_ATTR static time_t lastTimeSync = 0;
+RTC_DATA_ATTR static time_t dstStart = 0;             // 夏令时起止 (Unix时间，0表示无夏令时)
+RTC_DATA_ATTR static time_t dstEnd = 0;
+RTC_DATA_ATTR static int32_t dstShift = 0;            // 夏令时偏移 (秒)
+static volatile uint8_t dstReceived = 0;              // 已收到的夏令时属性 (bit0-2)
+static uint32_t dstRaw[3];                            // DstStart/DstEnd/DstShift 原始值
+static uint8_t scheduleWriteBuf[SCHEDULE_MAX_ENTRIES * sizeof(ScheduleEntry)];
+static volatile int scheduleWriteLen = -1;            // 远程写入的定时表长度，-1表示无
+static portMUX_TYPE scheduleWriteLock = portMUX_INITIALIZER_UNLOCKED;  // 串行化Zigbee任务与loop对暂存区的访问
+static volatile bool scheduleRestorePending = false;  // 远程写入被拒绝，需用当前定时表恢复属性
+static uint8_t scheduleAttrValue[1 + SCHEDULE_MAX_ENTRIES * sizeof(ScheduleEntry)];  // 长度前缀 + 数据
+static unsigned long lastTimeSyncAttempt = 0;
+static bool timeSyncAttempted = false;
+static int64_t scheduleNextAtUs = -1;                 // 下一条目到期时间 (esp_timer时基)
+
+// 灯光端点扩展: 接收夏令时属性读取结果和定时表写入
+class ZigbeeScheduleLight : public ZigbeeColorDimmableLight {
+public:
+  ZigbeeScheduleLight(uint8_t endpoint) : ZigbeeColorDimmableLight(endpoint) {}
+
+  void addScheduleCluster();
+  void zbAttributeSet(const esp_zb_zcl_set_attr_value_message_t *message) override;
+  void zbReadTimeCluster(const esp_zb_zcl_attribute_t *attribute) override;
+};
+
+ZigbeeScheduleLight zbLight(ZIGBEE_RGB_LIGHT_ENDPOINT);
+ZigbeeSwitch zbSwitch(ZIGBEE_SWITCH_ENDPOINT);
+ZigbeeBinary zbPress(ZIGBEE_PRESS_ENDPOINT);
 
 /********************* Forward Declarations **************************/
 void turnLightOn();
 void turnLightOff();
 void reportLightState();
+void reportPressConfirmed();
 
 /********************* Servo Control Functions **************************/
 void servoSetAngle(int angle) {
-  int duty = SERVO_DUTY_MIN + (angle * (SERVO_DUTY_MAX - SERVO_DUTY_MIN) / 180);
+  int duty = servoAngleToDuty(angle, SERVO_DUTY_MIN, SERVO_DUTY_MAX);
   ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, duty);
   ledc_update_duty(LEDC_MODE, LEDC_CHANNEL);
 }
@@ -117,16 +294,29 @@ void servoReturnCallback(void *arg) {
   servoAutoReturnPending = true;  // 在loop()中处理
 }
 
+// 定时器回调：到位后在loop()中采样确认
+void servoConfirmCallback(void *arg) {
+  servoConfirmPending = true;
+}
+
 // 舵机播放动作 (开灯时调用)
 void servoPlay() {
-  Serial.printf("[Servo] PLAY -> %d deg\n", SERVO_TARGET_ANGLE);
-  servoSetAngle(SERVO_TARGET_ANGLE);
+  servoPlayAngle = servoPressAngle;
+  servoRetryCount = 0;
+  Serial.printf("[Servo] PLAY -> %d deg\n", servoPlayAngle);
+  servoSetAngle(servoPlayAngle);
 
   // 启动/重启自动回位定时器
   if (servoTimer) {
     esp_timer_stop(servoTimer);
     esp_timer_start_once(servoTimer, SERVO_AUTO_RETURN_MS * 1000);
   }
+
+  // 启动按压确认定时器
+  if (servoConfirmTimer) {
+    esp_timer_stop(servoConfirmTimer);
+    esp_timer_start_once(servoConfirmTimer, SERVO_CONFIRM_DELAY_MS * 1000);
+  }
 }
 
 // 舵机休息位置 (关灯时调用)
@@ -137,6 +327,10 @@ void servoRest() {
   if (servoTimer) {
     esp_timer_stop(servoTimer);
   }
+  if (servoConfirmTimer) {
+    esp_timer_stop(servoConfirmTimer);
+    servoConfirmPending = false;
+  }
 
   servoSetAngle(SERVO_REST_ANGLE);
 }
@@ -180,6 +374,128 @@ void servoInit() {
   Serial.println("[Servo] Initialized");
 }
 
+/********************* Servo Current Sensing **************************/
+// 读取舵机电源电流 (mA)，多次采样取平均
+uint32_t servoReadCurrentMa() {
+  uint32_t sumMv = 0;
+  for (int i = 0; i < SERVO_SENSE_SAMPLES; i++) {
+    sumMv += analogReadMilliVolts(SERVO_SENSE_PIN);
+  }
+  return (sumMv / SERVO_SENSE_SAMPLES) * 1000 / SERVO_SHUNT_MILLIOHM;
+}
+
+bool servoInContact(uint32_t currentMa) {
+  return currentMa > servoBaselineMa + SERVO_CONTACT_CURRENT_MA;
+}
+
+// 校准: 从休息位置逐步转动，找到电流开始上升 (接触开关) 的最小角度
+void servoCalibrate() {
+  Serial.println("[Servo] Calibrating press angle...");
+
+  int contactAngle = -1;
+  for (int angle = SERVO_REST_ANGLE + SERVO_CALIB_STEP_DEG; angle <= SERVO_TARGET_ANGLE;
+       angle += SERVO_CALIB_STEP_DEG) {
+    servoSetAngle(angle);
+    delay(SERVO_CALIB_SETTLE_MS);
+
+    uint32_t current = servoReadCurrentMa();
+    if (servoInContact(current)) {
+      Serial.printf("[Servo] Contact at %d deg (%lu mA)\n", angle, (unsigned long)current);
+      contactAngle = angle;
+      break;
+    }
+  }
+
+  servoSetAngle(SERVO_REST_ANGLE);
+
+  Preferences prefs;
+  prefs.begin("servo", false);
+  if (contactAngle < 0) {
+    // 记录失败标记，之后的启动/唤醒直接使用SERVO_TARGET_ANGLE，不再重复扫描
+    Serial.println("[Servo] Calibration failed, using SERVO_TARGET_ANGLE");
+    servoPressAngle = SERVO_TARGET_ANGLE;
+    prefs.putBool("calib_failed", true);
+    prefs.end();
+    return;
+  }
+
+  servoPressAngle = min(contactAngle + SERVO_PRESS_MARGIN_DEG, SERVO_TARGET_ANGLE);
+  prefs.putInt("press_angle", servoPressAngle);
+  prefs.end();
+  Serial.printf("[Servo] Press angle calibrated: %d deg\n", servoPressAngle);
+}
+
+// 清除校准结果 (恢复出厂时调用，下次启动重新校准)
+void servoClearCalibration() {
+  Preferences prefs;
+  prefs.begin("servo", false);
+  prefs.remove("press_angle");
+  prefs.remove("calib_failed");
+  prefs.end();
+}
+
+// 在servoInit()之后调用: 测量空载基线，创建确认定时器
+void servoSenseInit() {
+  if (!SERVO_SENSE_ENABLED) return;
+
+  analogReadResolution(12);
+  if (!servoBaselineValid) {  // 深度睡眠唤醒时沿用上次基线，省去等待
+    delay(SERVO_SETTLE_MS);
+    servoBaselineMa = servoReadCurrentMa();
+    servoBaselineValid = true;
+  }
+  Serial.printf("[Servo] Baseline current: %lu mA\n", (unsigned long)servoBaselineMa);
+
+  esp_timer_create_args_t timer_args = {
+    .callback = servoConfirmCallback,
+    .arg = NULL,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "servo_confirm"
+  };
+  esp_timer_create(&timer_args, &servoConfirmTimer);
+}
+
+// 在handleWakeup()之后调用: 读取校准结果，未校准过才执行扫描
+void servoLoadCalibration() {
+  if (!SERVO_SENSE_ENABLED) return;
+
+  Preferences prefs;
+  prefs.begin("servo", true);
+  int stored = prefs.getInt("press_angle", -1);
+  bool failed = prefs.getBool("calib_failed", false);
+  prefs.end();
+
+  if (stored > SERVO_REST_ANGLE && stored <= SERVO_TARGET_ANGLE) {
+    servoPressAngle = stored;
+    Serial.printf("[Servo] Press angle: %d deg\n", servoPressAngle);
+  } else if (failed) {
+    servoPressAngle = SERVO_TARGET_ANGLE;
+    Serial.println("[Servo] Calibration previously failed, using SERVO_TARGET_ANGLE");
+  } else {
+    servoCalibrate();
+  }
+}
+
+// 按压确认 (loop上下文): 电流未上升则加大角度重试，最终结果上报
+void servoConfirm() {
+  uint32_t current = servoReadCurrentMa();
+  bool contact = servoInContact(current);
+  Serial.printf("[Servo] Confirm at %d deg: %lu mA -> %s\n",
+                servoPlayAngle, (unsigned long)current, contact ? "pressed" : "no contact");
+
+  if (!contact && servoRetryCount < SERVO_MAX_RETRIES && servoPlayAngle < SERVO_TARGET_ANGLE) {
+    servoRetryCount++;
+    servoPlayAngle = min(servoPlayAngle + SERVO_RETRY_STEP_DEG, SERVO_TARGET_ANGLE);
+    Serial.printf("[Servo] Retry %d -> %d deg\n", servoRetryCount, servoPlayAngle);
+    servoSetAngle(servoPlayAngle);
+    esp_timer_start_once(servoConfirmTimer, SERVO_CONFIRM_DELAY_MS * 1000);
+    return;
+  }
+
+  pressConfirmed = contact;
+  reportPressConfirmed();
+}
+
 /********************* LED Control Functions **************************/
 void ledSetColor(uint8_t r, uint8_t g, uint8_t b) {
   rgbLedWrite(LED_PIN, r, g, b);
@@ -215,23 +531,82 @@ void ledBlink(unsigned long interval, void (*colorFunc)()) {
   }
 }
 
-/********************* Light Control Functions **************************/
-uint16_t kelvinToMireds(uint16_t kelvin) {
-  return 1000000 / kelvin;
+/********************* Light State Mirror **************************/
+// 写入开始: seq变为奇数 (写入方之间由临界区互斥)
+void lightMirrorWriteBegin() {
+  portENTER_CRITICAL(&lightMirrorWriteLock);
+  __atomic_store_n(&lightMirror.seq, lightMirror.seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
 }
 
-uint16_t miredsToKelvin(uint16_t mireds) {
-  return 1000000 / mireds;
+// 写入结束: seq恢复为偶数
+void lightMirrorWriteEnd() {
+  __atomic_store_n(&lightMirror.seq, lightMirror.seq + 1, __ATOMIC_RELEASE);
+  portEXIT_CRITICAL(&lightMirrorWriteLock);
 }
 
+void lightMirrorWriteRgb(bool on, uint8_t r, uint8_t g, uint8_t b, uint8_t level) {
+  lightMirrorWriteBegin();
+  lightMirror.data.on = on;
+  lightMirror.data.level = level;
+  lightMirror.data.red = r;
+  lightMirror.data.green = g;
+  lightMirror.data.blue = b;
+  lightMirror.data.colorMode = LIGHT_MODE_RGB;
+  lightMirrorWriteEnd();
+}
+
+void lightMirrorWriteTemp(bool on, uint8_t level, uint16_t mireds) {
+  lightMirrorWriteBegin();
+  lightMirror.data.on = on;
+  lightMirror.data.level = level;
+  lightMirror.data.mireds = mireds;
+  lightMirror.data.colorMode = LIGHT_MODE_TEMP;
+  lightMirrorWriteEnd();
+}
+
+void lightMirrorWriteState(bool on) {
+  lightMirrorWriteBegin();
+  lightMirror.data.on = on;
+  lightMirrorWriteEnd();
+}
+
+// 无锁读取: seq为奇数或读取前后不一致时重试
+LightSnapshot lightMirrorRead() {
+  LightSnapshot snap;
+  uint32_t seqBefore, seqAfter;
+  do {
+    seqBefore = __atomic_load_n(&lightMirror.seq, __ATOMIC_ACQUIRE);
+    snap = lightMirror.data;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    seqAfter = __atomic_load_n(&lightMirror.seq, __ATOMIC_RELAXED);
+  } while ((seqBefore & 1) || seqBefore != seqAfter);
+  return snap;
+}
+
+// 启动后从属性表读取一次初始值 (之后只由回调更新)
+void lightMirrorSeed() {
+  lightMirrorWriteBegin();
+  lightMirror.data.on = zbLight.getLightState();
+  lightMirror.data.level = zbLight.getLightLevel();
+  lightMirror.data.red = zbLight.getLightRed();
+  lightMirror.data.green = zbLight.getLightGreen();
+  lightMirror.data.blue = zbLight.getLightBlue();
+  lightMirror.data.colorMode = LIGHT_MODE_RGB;
+  lightMirror.data.mireds = 0;  // 未知，等待首次色温回调
+  lightMirrorWriteEnd();
+}
+
+/********************* Light Control Functions **************************/
 // 开灯 (统一入口)
 void turnLightOn() {
   Serial.println("[Light] >>> turnLightOn()");
 
-  uint8_t level = zbLight.getLightLevel();
-  uint8_t r = zbLight.getLightRed();
-  uint8_t g = zbLight.getLightGreen();
-  uint8_t b = zbLight.getLightBlue();
+  LightSnapshot light = lightMirrorRead();
+  uint8_t level = light.level;
+  uint8_t r = light.red;
+  uint8_t g = light.green;
+  uint8_t b = light.blue;
 
   // 如果亮度为0，设置默认值
   if (level == 0) level = DEFAULT_BRIGHTNESS;
@@ -243,6 +618,7 @@ void turnLightOn() {
 
   Serial.printf("[Light] setLight(true, %d, %d, %d, %d)\n", level, r, g, b);
   zbLight.setLight(true, level, r, g, b);
+  lightMirrorWriteRgb(true, r, g, b, level);
   servoPlay();
 
   // 等待属性更新后再上报
@@ -257,6 +633,7 @@ void turnLightOff() {
   Serial.println("[Light] >>> turnLightOff()");
 
   zbLight.setLightState(false);
+  lightMirrorWriteState(false);
   ledOff();
   servoRest();
 
@@ -267,9 +644,27 @@ void turnLightOff() {
   Serial.println("[Light] <<< turnLightOff() done");
 }
 
+// 直连绑定: 向绑定的设备/组发送与本地一致的 On/Off (不用Toggle，避免两边错相)，协调器离线时仍可用
+// 不用zbSwitch.bound()预检: 它只在启动/重连时读取绑定表，运行中新增的绑定要重启才生效；
+// 未绑定时协议栈按绑定表寻址找不到目标，直接丢弃
+void sendBoundOnOff(bool on) {
+  if (!DIRECT_BINDING_ENABLED) return;
+  if (!Zigbee.connected()) return;
+
+  esp_zb_zcl_on_off_cmd_t cmd = {};
+  cmd.zcl_basic_cmd.src_endpoint = ZIGBEE_SWITCH_ENDPOINT;
+  cmd.address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT;
+  cmd.on_off_cmd_id = on ? ESP_ZB_ZCL_CMD_ON_OFF_ON_ID : ESP_ZB_ZCL_CMD_ON_OFF_OFF_ID;
+
+  Serial.printf("[Bind] Sending %s to bound devices\n", on ? "On" : "Off");
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_zb_zcl_on_off_cmd_req(&cmd);
+  esp_zb_lock_release();
+}
+
 // Toggle灯光状态
 void toggleLight() {
-  bool currentState = zbLight.getLightState();
+  bool currentState = lightMirrorRead().on;
   Serial.printf("Toggle light: %s -> %s\n",
                 currentState ? "ON" : "OFF",
                 !currentState ? "ON" : "OFF");
@@ -284,6 +679,7 @@ void toggleLight() {
 // Zigbee RGB模式回调
 void onRgbChange(bool on, uint8_t r, uint8_t g, uint8_t b, uint8_t level) {
   Serial.printf("[Zigbee] RGB change: on=%d, r=%d, g=%d, b=%d, level=%d\n", on, r, g, b, level);
+  lightMirrorWriteRgb(on, r, g, b, level);
 
   if (!on) {
     ledOff();
@@ -291,14 +687,15 @@ void onRgbChange(bool on, uint8_t r, uint8_t g, uint8_t b, uint8_t level) {
     return;
   }
 
-  float brightness = (float)level / 255.0f;
-  ledSetColor(r * brightness, g * brightness, b * brightness);
+  RgbColor color = scaleRgb(r, g, b, level);
+  ledSetColor(color.r, color.g, color.b);
   servoPlay();
 }
 
 // Zigbee色温模式回调
 void onTempChange(bool on, uint8_t level, uint16_t mireds) {
   Serial.printf("[Zigbee] Temp change: on=%d, level=%d, mireds=%d\n", on, level, mireds);
+  lightMirrorWriteTemp(on, level, mireds);
 
   if (!on) {
     ledOff();
@@ -306,11 +703,8 @@ void onTempChange(bool on, uint8_t level, uint16_t mireds) {
     return;
   }
 
-  float brightness = (float)level / 255.0f;
-  uint16_t kelvin = miredsToKelvin(mireds);
-  uint8_t warm = constrain(map(kelvin, 2000, 6500, 255, 0), 0, 255);
-  uint8_t cold = constrain(map(kelvin, 2000, 6500, 0, 255), 0, 255);
-  ledSetColor(warm * brightness, warm * brightness, cold * brightness);
+  RgbColor color = tempToRgb(level, mireds);
+  ledSetColor(color.r, color.g, color.b);
   servoPlay();
 }
 
@@ -390,18 +784,24 @@ void setupReporting() {
   setupLevelReporting();
 }
 
+// 构建发往协调器的属性报告命令
+void buildReportCmd(esp_zb_zcl_report_attr_cmd_t *cmd, uint16_t clusterId, uint16_t attrId) {
+  *cmd = {};
+  cmd->address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+  cmd->zcl_basic_cmd.dst_addr_u.addr_short = 0x0000;
+  cmd->zcl_basic_cmd.dst_endpoint = 1;
+  cmd->zcl_basic_cmd.src_endpoint = ZIGBEE_RGB_LIGHT_ENDPOINT;
+  cmd->clusterID = clusterId;
+  cmd->attributeID = attrId;
+  cmd->direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI;
+  cmd->manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC;
+}
+
 bool reportOnOff() {
   Serial.println("[Report] >>> reportOnOff()");
 
-  esp_zb_zcl_report_attr_cmd_t cmd = {};
-  cmd.address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
-  cmd.zcl_basic_cmd.dst_addr_u.addr_short = 0x0000;
-  cmd.zcl_basic_cmd.dst_endpoint = 1;
-  cmd.zcl_basic_cmd.src_endpoint = ZIGBEE_RGB_LIGHT_ENDPOINT;
-  cmd.clusterID = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF;
-  cmd.attributeID = ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID;
-  cmd.direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI;
-  cmd.manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC;
+  esp_zb_zcl_report_attr_cmd_t cmd;
+  buildReportCmd(&cmd, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID);
 
   Serial.println("[Report] Acquiring Zigbee lock...");
   esp_zb_lock_acquire(portMAX_DELAY);
@@ -419,15 +819,8 @@ bool reportOnOff() {
 }
 
 bool reportLevel() {
-  esp_zb_zcl_report_attr_cmd_t cmd = {};
-  cmd.address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
-  cmd.zcl_basic_cmd.dst_addr_u.addr_short = 0x0000;
-  cmd.zcl_basic_cmd.dst_endpoint = 1;
-  cmd.zcl_basic_cmd.src_endpoint = ZIGBEE_RGB_LIGHT_ENDPOINT;
-  cmd.clusterID = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL;
-  cmd.attributeID = ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID;
-  cmd.direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI;
-  cmd.manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC;
+  esp_zb_zcl_report_attr_cmd_t cmd;
+  buildReportCmd(&cmd, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID);
 
   esp_zb_lock_acquire(portMAX_DELAY);
   esp_err_t ret = esp_zb_zcl_report_attr_cmd_req(&cmd);
@@ -441,20 +834,358 @@ bool reportLevel() {
   return true;
 }
 
+// 上报按压确认结果 (Binary Input端点)
+void reportPressConfirmed() {
+  zbPress.setBinaryInput(pressConfirmed);
+  if (BATTERY_MODE) {  // 电池模式: 推迟到睡眠前发送，只保留最终状态
+    batteryPressReportPending = true;
+    return;
+  }
+  sendPressConfirmed();
+}
+
+void sendPressConfirmed() {
+  if (!Zigbee.connected()) return;
+
+  esp_zb_zcl_report_attr_cmd_t cmd;
+  buildReportCmd(&cmd, ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT, ESP_ZB_ZCL_ATTR_BINARY_INPUT_PRESENT_VALUE_ID);
+  cmd.zcl_basic_cmd.src_endpoint = ZIGBEE_PRESS_ENDPOINT;
+
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_err_t ret = esp_zb_zcl_report_attr_cmd_req(&cmd);
+  esp_zb_lock_release();
+
+  if (ret != ESP_OK) {
+    Serial.printf("Failed to report press confirmed: 0x%x\n", ret);
+    return;
+  }
+  Serial.printf("Press confirmed reported: %d\n", pressConfirmed);
+}
+
 void reportLightState() {
+  if (BATTERY_MODE) {  // 电池模式: 推迟到睡眠前发送，只保留最终状态
+    battery.reportPending = true;
+    return;
+  }
+  sendLightState();
+}
+
+void sendLightState() {
   if (!Zigbee.connected()) {
     Serial.println("[Report] Not connected, skip report");
     return;
   }
 
-  bool currentState = zbLight.getLightState();
-  uint8_t currentLevel = zbLight.getLightLevel();
-  Serial.printf("[Report] Reporting state: on=%d, level=%d\n", currentState, currentLevel);
+  LightSnapshot light = lightMirrorRead();
+  Serial.printf("[Report] Reporting state: on=%d, level=%d\n", light.on, light.level);
 
   reportOnOff();
   reportLevel();
 }
 
+/********************* Local Schedule **************************/
+// 从协调器Time cluster同步时间 (会阻塞等待响应，只在loop上下文调用)
+bool syncTime() {
+  struct tm utc = zbLight.getTime();
+  if (utc.tm_year < 100) {  // 2000年以前视为无效
+    Serial.println("[Time] Sync failed");
+    return false;
+  }
+
+  struct timeval tv = { .tv_sec = mktime(&utc), .tv_usec = 0 };
+  settimeofday(&tv, NULL);
+  timezoneOffset = zbLight.getTimezone();
+  syncDst();
+  timeSynced = true;
+  lastTimeSync = tv.tv_sec;
+
+  Serial.printf("[Time] Synced: %04d-%02d-%02d %02d:%02d:%02d UTC, tz=%lds, dst=%lds\n",
+                utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                utc.tm_hour, utc.tm_min, utc.tm_sec, (long)timezoneOffset, (long)dstShift);
+  return true;
+}
+
+// 读取协调器Time cluster的DstStart/DstEnd/DstShift，结果在zbReadTimeCluster()中接收
+void syncDst() {
+  uint16_t attributes[] = {
+    ESP_ZB_ZCL_ATTR_TIME_DST_START_ID,
+    ESP_ZB_ZCL_ATTR_TIME_DST_END_ID,
+    ESP_ZB_ZCL_ATTR_TIME_DST_SHIFT_ID
+  };
+
+  esp_zb_zcl_read_attr_cmd_t req = {};
+  req.address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+  req.zcl_basic_cmd.dst_addr_u.addr_short = 0x0000;
+  req.zcl_basic_cmd.dst_endpoint = 1;
+  req.zcl_basic_cmd.src_endpoint = ZIGBEE_RGB_LIGHT_ENDPOINT;
+  req.clusterID = ESP_ZB_ZCL_CLUSTER_ID_TIME;
+  req.attr_number = 3;
+  req.attr_field = attributes;
+
+  dstReceived = 0;
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_zb_zcl_read_attr_cmd_req(&req);
+  esp_zb_lock_release();
+
+  unsigned long start = millis();
+  while (dstReceived != 0x07 && millis() - start < TIME_DST_TIMEOUT_MS) {
+    delay(10);
+  }
+
+  // 0xFFFFFFFF 表示协调器未配置夏令时
+  if (dstReceived != 0x07 || dstRaw[0] == 0xFFFFFFFF || dstRaw[1] == 0xFFFFFFFF) {
+    Serial.println("[Time] No DST info, DST disabled");
+    dstStart = dstEnd = 0;
+    dstShift = 0;
+    return;
+  }
+
+  dstStart = dstRaw[0] + ZCL_TIME_EPOCH_OFFSET;
+  dstEnd = dstRaw[1] + ZCL_TIME_EPOCH_OFFSET;
+  dstShift = (int32_t)dstRaw[2];
+}
+
+// 指定UTC时刻的本地时间偏移 (时区 + 夏令时)
+int32_t localOffsetAt(time_t utc) {
+  bool inDst = dstStart != 0 && utc >= dstStart && utc < dstEnd;
+  return timezoneOffset + (inDst ? dstShift : 0);
+}
+
+void ZigbeeScheduleLight::zbReadTimeCluster(const esp_zb_zcl_attribute_t *attribute) {
+  int index = -1;
+  switch (attribute->id) {
+    case ESP_ZB_ZCL_ATTR_TIME_DST_START_ID: index = 0; break;
+    case ESP_ZB_ZCL_ATTR_TIME_DST_END_ID:   index = 1; break;
+    case ESP_ZB_ZCL_ATTR_TIME_DST_SHIFT_ID: index = 2; break;
+    default:
+      ZigbeeColorDimmableLight::zbReadTimeCluster(attribute);  // Time/TimeZone由库处理
+      return;
+  }
+
+  if (attribute->data.value) {
+    memcpy(&dstRaw[index], attribute->data.value, sizeof(dstRaw[index]));  // 属性缓冲区不保证4字节对齐
+    dstReceived |= 1 << index;
+  }
+}
+
+void scheduleTimerCallback(void *arg) {
+  schedulePending = true;  // 在loop()中处理
+}
+
+// 从NVS读取定时表 (由远程写入保存，无表时为空)
+void scheduleLoad() {
+  Preferences prefs;
+  prefs.begin("schedule", true);
+
+  size_t len = prefs.getBytesLength("table");
+  scheduleCount = 0;
+  if (len <= sizeof(scheduleTable) && len % sizeof(ScheduleEntry) == 0) {
+    prefs.getBytes("table", scheduleTable, len);
+    scheduleCount = len / sizeof(ScheduleEntry);
+  }
+
+  prefs.end();
+  Serial.printf("[Schedule] %d entries loaded\n", scheduleCount);
+}
+
+// 按当前定时表填充属性值 (长度前缀 + 数据)
+void scheduleFillAttrValue() {
+  scheduleAttrValue[0] = scheduleCount * sizeof(ScheduleEntry);
+  memcpy(&scheduleAttrValue[1], scheduleTable, scheduleAttrValue[0]);
+}
+
+// 在灯光端点上添加定时表私有cluster (在Zigbee.addEndpoint()之前调用)
+void ZigbeeScheduleLight::addScheduleCluster() {
+  scheduleFillAttrValue();
+
+  esp_zb_attribute_list_t *attrs = esp_zb_zcl_attr_list_create(SCHEDULE_CLUSTER_ID);
+  esp_zb_custom_cluster_add_custom_attr(attrs, SCHEDULE_ATTR_TABLE_ID, ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE, scheduleAttrValue);
+  esp_zb_cluster_list_add_custom_cluster(_cluster_list, attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+}
+
+// 远程写入定时表 (Zigbee任务上下文): 暂存后由loop()保存并重新设定
+// 回调时协议栈已保存写入值并回复成功，非法写入只能由loop()用当前定时表恢复属性
+void ZigbeeScheduleLight::zbAttributeSet(const esp_zb_zcl_set_attr_value_message_t *message) {
+  if (message->info.cluster != SCHEDULE_CLUSTER_ID) {
+    ZigbeeColorDimmableLight::zbAttributeSet(message);
+    return;
+  }
+  if (message->attribute.id != SCHEDULE_ATTR_TABLE_ID || !message->attribute.data.value) return;
+
+  const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+  uint8_t len = value[0];
+  if (len > sizeof(scheduleWriteBuf) || len % sizeof(ScheduleEntry) != 0) {
+    Serial.printf("[Schedule] Invalid table length: %d\n", len);
+    scheduleRestorePending = true;
+    return;
+  }
+
+  for (int i = 1; i < len; i += sizeof(ScheduleEntry)) {
+    const ScheduleEntry *entry = (const ScheduleEntry *)&value[i];
+    if (entry->hour > 23 || entry->minute > 59 || entry->action > SCHEDULE_ACTION_TOGGLE) {
+      Serial.printf("[Schedule] Invalid entry %d, table rejected\n", i / (int)sizeof(ScheduleEntry));
+      scheduleRestorePending = true;
+      return;
+    }
+  }
+
+  portENTER_CRITICAL(&scheduleWriteLock);
+  memcpy(scheduleWriteBuf, &value[1], len);
+  scheduleWriteLen = len;
+  portEXIT_CRITICAL(&scheduleWriteLock);
+}
+
+// 保存远程写入的定时表 (loop上下文)
+void scheduleApplyWrite() {
+  portENTER_CRITICAL(&scheduleWriteLock);
+  int len = scheduleWriteLen;
+  scheduleWriteLen = -1;
+  if (len >= 0) {
+    memcpy(scheduleTable, scheduleWriteBuf, len);
+  }
+  portEXIT_CRITICAL(&scheduleWriteLock);
+  if (len < 0) return;
+
+  scheduleCount = len / sizeof(ScheduleEntry);
+
+  Preferences prefs;
+  prefs.begin("schedule", false);
+  prefs.putBytes("table", scheduleTable, len);
+  prefs.end();
+
+  Serial.printf("[Schedule] Table updated: %d entries\n", scheduleCount);
+  scheduleArm();
+}
+
+// 用当前定时表覆盖被拒绝的写入值 (loop上下文)，读回的属性与实际执行的定时表一致
+void scheduleRestoreAttr() {
+  scheduleRestorePending = false;
+  scheduleFillAttrValue();
+
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_zb_zcl_status_t status = esp_zb_zcl_set_attribute_val(ZIGBEE_RGB_LIGHT_ENDPOINT, SCHEDULE_CLUSTER_ID,
+                                                            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, SCHEDULE_ATTR_TABLE_ID,
+                                                            scheduleAttrValue, false);
+  esp_zb_lock_release();
+
+  if (status != ESP_ZB_ZCL_STATUS_SUCCESS) {
+    Serial.printf("[Schedule] Failed to restore table attribute: 0x%x\n", status);
+    return;
+  }
+  Serial.printf("[Schedule] Table attribute restored: %d entries\n", scheduleCount);
+}
+
+// 设定时器到下一个条目，返回是否已设定
+bool scheduleArm() {
+  esp_timer_stop(scheduleTimer);
+  scheduleNextIndex = -1;
+  scheduleNextAtUs = -1;
+  if (!timeSynced || scheduleCount == 0) return false;
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int32_t nowOffset = localOffsetAt(tv.tv_sec);
+  time_t local = tv.tv_sec + nowOffset;
+  struct tm now;
+  gmtime_r(&local, &now);
+  long nowSec = now.tm_hour * 3600L + now.tm_min * 60L + now.tm_sec;
+
+  long bestDelta = 0;
+  for (int i = 0; i < scheduleCount; i++) {
+    const ScheduleEntry &entry = scheduleTable[i];
+    long entrySec = entry.hour * 3600L + entry.minute * 60L;
+    for (int day = 0; day <= 7; day++) {
+      if (!(entry.days & (1 << ((now.tm_wday + day) % 7)))) continue;
+      long delta = day * 86400L + entrySec - nowSec;
+      if (delta <= 0) continue;
+      if (scheduleNextIndex < 0 || delta < bestDelta) {
+        bestDelta = delta;
+        scheduleNextIndex = i;
+      }
+      break;
+    }
+  }
+
+  if (scheduleNextIndex < 0) return false;
+
+  // 到期前跨越夏令时切换时，按到期时刻的偏移修正
+  bestDelta -= localOffsetAt(tv.tv_sec + bestDelta) - nowOffset;
+  if (bestDelta <= 0) bestDelta = 1;
+
+  uint64_t delayUs = (uint64_t)bestDelta * 1000000ULL - tv.tv_usec;
+  esp_timer_start_once(scheduleTimer, delayUs);
+  scheduleNextAtUs = esp_timer_get_time() + delayUs;
+  Serial.printf("[Schedule] Next: entry %d in %lds\n", scheduleNextIndex, bestDelta);
+  return true;
+}
+
+void scheduleInit() {
+  esp_timer_create_args_t timer_args = {
+    .callback = scheduleTimerCallback,
+    .arg = NULL,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "schedule_timer"
+  };
+  esp_timer_create(&timer_args, &scheduleTimer);
+  scheduleLoad();
+}
+
+// 执行到期条目，状态通过turnLightOn/Off中的上报路径同步
+void scheduleRun() {
+  if (scheduleNextIndex >= 0) {
+    const ScheduleEntry &entry = scheduleTable[scheduleNextIndex];
+    Serial.printf("[Schedule] Run entry %d (%02d:%02d, action=%d)\n",
+                  scheduleNextIndex, entry.hour, entry.minute, entry.action);
+
+    switch (entry.action) {
+      case SCHEDULE_ACTION_ON:
+        turnLightOn();
+        break;
+      case SCHEDULE_ACTION_OFF:
+        turnLightOff();
+        break;
+      case SCHEDULE_ACTION_TOGGLE:
+        toggleLight();
+        break;
+    }
+  }
+
+  scheduleArm();
+}
+
+// 距下一条目到期的毫秒数，未设定返回 -1
+long scheduleNextDelayMs() {
+  if (scheduleNextAtUs < 0) return -1;
+  int64_t remaining = scheduleNextAtUs - esp_timer_get_time();
+  return remaining > 0 ? (long)(remaining / 1000) : 0;
+}
+
+// 连接后同步时间并设定时器，之后每TIME_RESYNC_MS重新同步
+void updateSchedule() {
+  if (scheduleWriteLen >= 0) {
+    scheduleApplyWrite();
+  }
+  if (scheduleRestorePending) {  // 在保存之后，恢复的是最新的定时表
+    scheduleRestoreAttr();
+  }
+
+  if (schedulePending) {
+    schedulePending = false;
+    scheduleRun();
+  }
+
+  if (!Zigbee.connected()) return;
+  if (timeSyncAttempted && millis() - lastTimeSyncAttempt < TIME_RETRY_MS) return;
+  if (timeSynced && time(NULL) - lastTimeSync < (time_t)(TIME_RESYNC_MS / 1000)) return;
+
+  timeSyncAttempted = true;
+  lastTimeSyncAttempt = millis();
+  if (syncTime()) {
+    scheduleArm();
+  }
+}
+
 /********************* Button Handling **************************/
 ButtonAction checkButton() {
   static bool wasPressed = false;
@@ -486,12 +1217,14 @@ void handleButton(ButtonAction action) {
   switch (action) {
     case BUTTON_SHORT_PRESS:
       Serial.println("Short press: Toggle light");
+      sendBoundOnOff(!lightMirrorRead().on);  // 先发远程命令 (本地新状态)，避免被舵机/上报延时拖慢
       toggleLight();
       break;
 
     case BUTTON_LONG_PRESS:
       Serial.println("Long press: Factory reset");
       ledRed();
+      servoClearCalibration();
       delay(500);
       Zigbee.factoryReset();
       break;
@@ -501,6 +1234,69 @@ void handleButton(ButtonAction action) {
   }
 }
 
+/********************* Commissioning **************************/
+// 按安装码长度 (含CRC) 返回类型，长度非法返回 -1
+int installCodeTypeForLength(size_t len) {
+  switch (len) {
+    case 8:  return ESP_ZB_IC_TYPE_48;
+    case 10: return ESP_ZB_IC_TYPE_64;
+    case 14: return ESP_ZB_IC_TYPE_96;
+    case 18: return ESP_ZB_IC_TYPE_128;
+    default: return -1;
+  }
+}
+
+// 读取工厂NVS分区 (分区或命名空间不存在时视为未预配置)
+void loadCommissioningConfig() {
+  Preferences mfg;
+  if (!mfg.begin(MFG_NVS_NAMESPACE, true, MFG_NVS_PARTITION)) {
+    Serial.println("[Commission] No manufacturing data, manual pairing");
+    return;
+  }
+
+  size_t icLen = mfg.getBytesLength("ic");
+  int icType = installCodeTypeForLength(icLen);
+  if (icType >= 0 && mfg.getBytes("ic", commissioning.installCode, icLen) == icLen) {
+    commissioning.hasInstallCode = true;
+    commissioning.installCodeType = icType;
+  } else if (icLen > 0) {
+    Serial.printf("[Commission] Invalid install code length: %u\n", (unsigned)icLen);
+  }
+
+  commissioning.channelMask = mfg.getULong("ch_mask", 0);
+  mfg.end();
+
+  commissioning.provisioned = commissioning.hasInstallCode || commissioning.channelMask != 0;
+  Serial.printf("[Commission] Provisioned: ic=%d, ch_mask=0x%08lx\n",
+                commissioning.hasInstallCode, (unsigned long)commissioning.channelMask);
+}
+
+// 在Zigbee.begin()之前调用: 只扫描预配置的信道
+void applyChannelMask() {
+  if (commissioning.channelMask == 0) return;
+  Zigbee.setPrimaryChannelMask(commissioning.channelMask);
+}
+
+// 在Zigbee.begin()之后调用: 安装码需要协议栈已初始化，而Arduino库在begin()内部
+// 已自动开始首次入网，因此首次尝试仍使用默认信任中心密钥，安装码从库的下一次重试起生效
+void applyInstallCode() {
+  if (!commissioning.hasInstallCode) return;
+
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_err_t ret = esp_zb_secur_ic_set(commissioning.installCodeType, commissioning.installCode);
+  esp_zb_lock_release();
+
+  if (ret != ESP_OK) {
+    Serial.printf("[Commission] Failed to set install code: 0x%x\n", ret);
+    return;
+  }
+  Serial.println("[Commission] Install code set");
+}
+
+unsigned long pairingTimeoutMs() {
+  return commissioning.provisioned ? PROVISIONED_PAIRING_TIMEOUT_MS : PAIRING_TIMEOUT_MS;
+}
+
 /********************* Pairing State Machine **************************/
 void updatePairingState() {
   bool connected = Zigbee.connected();
@@ -523,7 +1319,7 @@ void updatePairingState() {
         zbLight.restoreLight();
         delay(500);
         reportLightState();
-      } else if (elapsed > PAIRING_TIMEOUT_MS) {
+      } else if (elapsed > pairingTimeoutMs()) {
         state.pairing = PAIRING_FAILED;
         Serial.println("Pairing timeout!");
       } else {
@@ -531,7 +1327,7 @@ void updatePairingState() {
 
         static unsigned long lastPrint = 0;
         if (millis() - lastPrint > 1000) {
-          Serial.printf("Pairing... %lus / %lus\n", elapsed / 1000, PAIRING_TIMEOUT_MS / 1000);
+          Serial.printf("Pairing... %lus / %lus\n", elapsed / 1000, pairingTimeoutMs() / 1000);
           lastPrint = millis();
         }
       }
@@ -540,7 +1336,11 @@ void updatePairingState() {
     case PAIRING_FAILED:
       ledRed();
       delay(2000);
-      enterDeepSleep();
+      if (commissioning.provisioned) {
+        enterTimedDeepSleep(PROVISIONED_RETRY_SLEEP_MS);  // 无需按键，定时重试
+      } else {
+        enterDeepSleep();
+      }
       break;
   }
 }
@@ -561,9 +1361,21 @@ void enterDeepSleep() {
   esp_deep_sleep_start();
 }
 
+// 深度睡眠，按键或定时器唤醒 (预配置设备配网失败后自动重试)
+void enterTimedDeepSleep(unsigned long sleepMs) {
+  Serial.printf("Timer wakeup in %lus\n", sleepMs / 1000);
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+  enterDeepSleep();
+}
+
 bool handleWakeup() {
   esp_sleep_wakeup_cause_t reason = esp_sleep_get_wakeup_cause();
 
+  if (BATTERY_MODE && battery.joined) {
+    batteryOnWakeup(reason);
+    return true;
+  }
+
   if (reason == ESP_SLEEP_WAKEUP_GPIO) {
     Serial.println("Woke up from deep sleep!");
 
@@ -577,12 +1389,245 @@ bool handleWakeup() {
     }
 
     Serial.println("Short press, going back to sleep...");
-    enterDeepSleep();
+    if (commissioning.provisioned) {
+      enterTimedDeepSleep(PROVISIONED_RETRY_SLEEP_MS);
+    } else {
+      enterDeepSleep();
+    }
+  }
+
+  if (reason == ESP_SLEEP_WAKEUP_TIMER) {
+    Serial.println("Timer wakeup, retrying pairing...");
   }
 
   return true;
 }
 
+/********************* Battery Mode **************************/
+// 唤醒处理 (已入网): 统计睡眠时长，记录按键动作，连接后在loop中执行
+void batteryOnWakeup(esp_sleep_wakeup_cause_t reason) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t nowUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  if (battery.sleepEnterUs > 0 && nowUs > battery.sleepEnterUs) {
+    battery.sleepMsTotal += (nowUs - battery.sleepEnterUs) / 1000;
+  }
+  battery.wakeCount++;
+
+  if (reason == ESP_SLEEP_WAKEUP_GPIO) {
+    // 等待松开以区分短按/长按 (与唤醒后的checkButton互不重复)
+    unsigned long pressStart = millis();
+    batteryWakeAction = BUTTON_SHORT_PRESS;
+    while (digitalRead(BUTTON_PIN) == LOW) {
+      delay(10);
+      if (millis() - pressStart > LONG_PRESS_MS) {
+        batteryWakeAction = BUTTON_LONG_PRESS;
+        break;
+      }
+    }
+    Serial.printf("[Battery] Wake #%lu: button (%s)\n", (unsigned long)battery.wakeCount,
+                  batteryWakeAction == BUTTON_LONG_PRESS ? "long" : "short");
+  } else {
+    battery.reportPending = true;  // 心跳/定时唤醒: 至少上报一次当前状态
+    Serial.printf("[Battery] Wake #%lu: timer\n", (unsigned long)battery.wakeCount);
+  }
+}
+
+// 舵机动作或按压确认尚未结束
+bool batteryBusy() {
+  if (servoAutoReturnPending || servoConfirmPending) return true;
+  if (servoTimer && esp_timer_is_active(servoTimer)) return true;
+  if (servoConfirmTimer && esp_timer_is_active(servoConfirmTimer)) return true;
+
+  long scheduleMs = scheduleNextDelayMs();
+  return scheduleMs >= 0 && scheduleMs <= (long)BATTERY_SCHEDULE_LEAD_MS;
+}
+
+// 睡眠前依次发出本次唤醒推迟的上报 (OnOff/Level/Binary Input各自成帧)
+void batteryFlushReports() {
+  if (!Zigbee.connected()) {
+    Serial.println("[Battery] Not connected, report deferred to next wake");
+    return;
+  }
+
+  if (battery.reportPending) {
+    sendLightState();
+    battery.reportPending = false;
+  }
+  if (batteryPressReportPending) {
+    sendPressConfirmed();
+    batteryPressReportPending = false;
+  }
+
+  if (battery.wakeCount > 0 && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+    battery.lastLatencyMs = esp_timer_get_time() / 1000;  // esp_timer从唤醒启动时开始计时
+    battery.maxLatencyMs = max(battery.maxLatencyMs, battery.lastLatencyMs);
+  }
+}
+
+void batteryPrintStats(uint32_t awakeMs) {
+  uint64_t totalMs = battery.awakeMsTotal + battery.sleepMsTotal;
+  uint64_t avgUa = totalMs ? (battery.awakeMsTotal * BATTERY_ACTIVE_CURRENT_UA +
+                              battery.sleepMsTotal * BATTERY_SLEEP_CURRENT_UA) / totalMs : 0;
+
+  Serial.printf("[Battery] Awake %lums, wakes=%lu, avg current ~%lu uA\n",
+                (unsigned long)awakeMs, (unsigned long)battery.wakeCount, (unsigned long)avgUa);
+  Serial.printf("[Battery] Press-to-report latency: last=%lums max=%lums\n",
+                (unsigned long)battery.lastLatencyMs, (unsigned long)battery.maxLatencyMs);
+}
+
+// 发出上报、记录统计后深度睡眠，睡眠时长取心跳与下一定时条目的较小值
+void batterySleep() {
+  batteryFlushReports();
+
+  // 按键仍按下时低电平会立即唤醒，先等待松开 (占用同一个唤醒窗口，不额外延长)
+  while (digitalRead(BUTTON_PIN) == LOW && millis() - batteryWindowStartMs < BATTERY_AWAKE_WINDOW_MS) {
+    delay(10);
+  }
+  bool buttonStuck = digitalRead(BUTTON_PIN) == LOW;
+
+  unsigned long sleepMs = BATTERY_HEARTBEAT_MS;
+  long scheduleMs = scheduleNextDelayMs();
+  if (scheduleMs >= 0 && scheduleMs - (long)BATTERY_SCHEDULE_LEAD_MS < (long)sleepMs) {
+    sleepMs = max(scheduleMs - (long)BATTERY_SCHEDULE_LEAD_MS, 0L);
+  }
+
+  uint32_t awakeMs = esp_timer_get_time() / 1000;
+  battery.awakeMsTotal += awakeMs;
+  batteryPrintStats(awakeMs);
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  battery.sleepEnterUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+  if (buttonStuck) {
+    // 按键卡住: 只用定时器唤醒，避免低电平反复唤醒耗电
+    Serial.printf("[Battery] Button still held, timer wakeup in %lus\n", sleepMs / 1000);
+    ledOff();
+    servoRest();
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+    Serial.flush();
+    esp_deep_sleep_start();
+  }
+  enterTimedDeepSleep(sleepMs);
+}
+
+// 主循环调用: 执行唤醒按键动作，事务完成或超出唤醒窗口后睡眠
+void updateBattery() {
+  if (!BATTERY_MODE) return;
+
+  bool connected = Zigbee.connected();
+  if (connected && !battery.joined) {
+    batteryFirstJoinMs = millis();
+    Serial.printf("[Battery] First join, staying awake %lus for interview\n",
+                  BATTERY_FIRST_JOIN_AWAKE_MS / 1000);
+  }
+  if (connected) {
+    battery.joined = true;
+  } else if (!battery.joined) {
+    return;  // 首次配网走原有配网流程
+  }
+
+  // 短按等待重连 (同时发出直连绑定命令)，重连失败则离线执行
+  if ((connected || batteryOffline) && batteryWakeAction != BUTTON_NONE) {
+    ButtonAction action = batteryWakeAction;
+    batteryWakeAction = BUTTON_NONE;
+    handleButton(action);
+  }
+
+  // 首次入网: 保持唤醒让协调器完成设备查询和绑定/报告配置，唤醒窗口从其结束时算起
+  if (batteryFirstJoinMs > 0) {
+    if (millis() - batteryFirstJoinMs < BATTERY_FIRST_JOIN_AWAKE_MS) return;
+    batteryWindowStartMs = batteryFirstJoinMs + BATTERY_FIRST_JOIN_AWAKE_MS;
+  }
+
+  bool windowExpired = millis() - batteryWindowStartMs > BATTERY_AWAKE_WINDOW_MS;
+  bool waitingForJoin = !connected && !batteryOffline;
+  if (!windowExpired && (waitingForJoin || batteryWakeAction != BUTTON_NONE || batteryBusy())) {
+    return;
+  }
+
+  if (windowExpired) {
+    Serial.println("[Battery] Awake window expired");
+  }
+  batterySleep();
+}
+
+/********************* Benchmark **************************/
+#ifdef BENCHMARK_MODE
+// BENCH_ITERATIONS 和纯计算用例定义在 bench_cases.h (与主机基准测试共用)
+const int BENCH_SEND_ITERATIONS = 50;                // 报告发送次数 (避免占满信道)
+const unsigned long BENCH_SEND_INTERVAL_MS = 100;    // 报告发送间隔
+
+static esp_zb_zcl_report_attr_cmd_t benchReportCmd;  // 预先构建，发送计时不含构建
+
+// 输出 p50/p99/max (单位: CPU周期)
+void benchPrint(const char *name, BenchStats stats, int count) {
+  Serial.printf("[Bench] %-16s n=%5d p50=%8lu p99=%8lu max=%8lu\n",
+                name, count, (unsigned long)stats.p50, (unsigned long)stats.p99, (unsigned long)stats.max);
+}
+
+// 测量 fn(i) 的CPU周期数，interval 为两次调用之间的非计时间隔
+void benchRun(const char *name, void (*fn)(int), int count, unsigned long interval) {
+  for (int i = 0; i < count; i++) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    fn(i);
+    benchSamples[i] = esp_cpu_get_cycle_count() - start;
+    if (interval) delay(interval);
+  }
+  benchPrint(name, benchStats(benchSamples, count), count);
+}
+
+// 纯计算用例 (bench_cases.h): 不含串口输出和定时器操作，计时方式与主机基准测试一致
+void benchRunPure(const char *name, void (*fn)(int)) {
+  benchPrint(name, benchMeasure(fn, BENCH_ITERATIONS), BENCH_ITERATIONS);
+}
+
+void benchServoSetAngle(int i) { servoSetAngle(i % 181); }
+void benchCheckButton(int i) { checkButton(); }
+void benchLedSetColor(int i) { ledSetColor(i & 0xFF, (i >> 2) & 0xFF, (i >> 4) & 0xFF); }
+void benchRgbLedWrite(int i) { rgbLedWrite(LED_PIN, i & 0xFF, (i >> 2) & 0xFF, (i >> 4) & 0xFF); }
+
+void benchReportBuild(int i) {
+  esp_zb_zcl_report_attr_cmd_t cmd;
+  buildReportCmd(&cmd, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID);
+  __asm__ __volatile__("" : : "r"(&cmd) : "memory");  // 防止被优化掉
+}
+
+// 只计报告请求本身 (含Zigbee锁)，不含reportOnOff()中的串口输出
+void benchReportSend(int i) {
+  esp_zb_lock_acquire(portMAX_DELAY);
+  esp_zb_zcl_report_attr_cmd_req(&benchReportCmd);
+  esp_zb_lock_release();
+}
+
+void runBenchmarks() {
+  Serial.printf("[Bench] CPU %lu MHz, %d iterations\n", (unsigned long)getCpuFrequencyMhz(), BENCH_ITERATIONS);
+
+  benchRunPure("baseline", benchBaseline);
+  benchRunPure("servoAngleToDuty", benchServoAngleToDuty);
+  benchRunPure("scaleRgb", benchScaleRgb);
+  benchRunPure("tempToRgb", benchTempToRgb);
+  benchRun("servoSetAngle", benchServoSetAngle, BENCH_ITERATIONS, 0);
+  benchRun("checkButton", benchCheckButton, BENCH_ITERATIONS, 0);
+  benchRun("ledSetColor", benchLedSetColor, BENCH_ITERATIONS, 0);
+  benchRun("rgbLedWrite", benchRgbLedWrite, BENCH_ITERATIONS, 0);
+  benchRun("reportBuild", benchReportBuild, BENCH_ITERATIONS, 0);
+
+  if (Zigbee.connected()) {
+    buildReportCmd(&benchReportCmd, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID);
+    benchRun("reportSend", benchReportSend, BENCH_SEND_ITERATIONS, BENCH_SEND_INTERVAL_MS);
+  } else {
+    Serial.println("[Bench] Not connected, skip reportSend");
+  }
+
+  // 恢复初始状态
+  servoRest();
+  ledOff();
+  Serial.println("[Bench] Done");
+}
+#endif
+
 /********************* Arduino Entry Points **************************/
 void setup() {
   Serial.begin(115200);
@@ -593,12 +1638,22 @@ void setup() {
 
   // 初始化舵机
   servoInit();
+  servoSenseInit();
+
+  // 初始化本地定时
+  scheduleInit();
+
+  // 读取工厂预配置数据
+  loadCommissioningConfig();
 
   // 处理唤醒
   if (!handleWakeup()) {
     return;
   }
 
+  // 读取或执行按压角度校准 (放在唤醒判断之后，重新睡眠的唤醒不做扫描)
+  servoLoadCalibration();
+
   // 配置Zigbee灯
   uint16_t capabilities = ZIGBEE_COLOR_CAPABILITY_X_Y | ZIGBEE_COLOR_CAPABILITY_COLOR_TEMP;
   zbLight.setLightColorCapabilities(capabilities);
@@ -607,28 +1662,77 @@ void setup() {
   zbLight.onIdentify(onIdentify);
   zbLight.setManufacturerAndModel("Espressif", "ZBColorLightBulb");
   zbLight.setLightColorTemperatureRange(kelvinToMireds(6500), kelvinToMireds(2000));
+  zbLight.addTimeCluster();
+  zbLight.addScheduleCluster();
+
+  // 配置On/Off客户端 (直连绑定)
+  if (DIRECT_BINDING_ENABLED) {
+    zbSwitch.setManufacturerAndModel("Espressif", "ZBColorLightBulb");
+    zbSwitch.allowMultipleBinding(true);
+  }
+
+  // 配置按压确认 (Binary Input)
+  if (SERVO_SENSE_ENABLED) {
+    zbPress.setManufacturerAndModel("Espressif", "ZBColorLightBulb");
+    zbPress.addBinaryInput();
+    zbPress.setBinaryInputDescription("Press confirmed");
+  }
+
+  // 电池模式: 声明电池供电，缩短重连等待
+  if (BATTERY_MODE) {
+    zbLight.setPowerSource(ZB_POWER_SOURCE_BATTERY);
+    Zigbee.setTimeout(BATTERY_JOIN_TIMEOUT_MS);
+  }
 
   // 启动Zigbee
   Serial.println("Starting Zigbee...");
+  applyChannelMask();
   Zigbee.addEndpoint(&zbLight);
+  if (DIRECT_BINDING_ENABLED) {
+    Zigbee.addEndpoint(&zbSwitch);
+  }
+  if (SERVO_SENSE_ENABLED) {
+    Zigbee.addEndpoint(&zbPress);
+  }
+
+  bool zigbeeStarted = Zigbee.begin();
 
-  if (!Zigbee.begin()) {
-    Serial.println("Zigbee failed! Rebooting...");
-    ESP.restart();
+  // 电池模式: 唤醒时的长按不看重连结果，协调器离线时也能恢复出厂
+  if (batteryWakeAction == BUTTON_LONG_PRESS) {
+    batteryWakeAction = BUTTON_NONE;
+    handleButton(BUTTON_LONG_PRESS);
   }
 
+  if (!zigbeeStarted) {
+    if (BATTERY_MODE && battery.joined) {
+      // 定时表在NVS、时间在RTC内存中，离线照常执行；只有上报要等下次唤醒
+      Serial.println("Zigbee rejoin failed, running offline until next wake...");
+      batteryOffline = true;
+    } else {
+      Serial.println("Zigbee failed! Rebooting...");
+      ESP.restart();
+    }
+  }
+
+  applyInstallCode();
   Serial.println("Zigbee started, entering main loop...");
+  lightMirrorSeed();
 
   // 初始化状态
   state.pairingStartTime = millis();
   if (Zigbee.connected()) {
     state.pairing = PAIRING_IDLE;
     setupReporting();
-    delay(500);
+    if (!BATTERY_MODE) delay(500);
     reportLightState();
   } else {
     state.pairing = PAIRING_IN_PROGRESS;
   }
+  scheduleArm();  // 深度睡眠唤醒后时间仍有效，不论是否连上都直接设定下一条目
+
+#ifdef BENCHMARK_MODE
+  runBenchmarks();
+#endif
 }
 
 void loop() {
@@ -639,6 +1743,12 @@ void loop() {
     turnLightOff();
   }
 
+  // 1.1 处理舵机按压确认
+  if (servoConfirmPending) {
+    servoConfirmPending = false;
+    servoConfirm();
+  }
+
   // 2. 处理按钮
   ButtonAction action = checkButton();
   if (action != BUTTON_NONE) {
@@ -648,6 +1758,12 @@ void loop() {
   // 3. 处理配网状态
   updatePairingState();
 
-  // 4. 短延迟
+  // 4. 处理本地定时 (时间同步 + 到期执行)
+  updateSchedule();
+
+  // 5. 电池模式: 事务完成后深度睡眠
+  updateBattery();
+
+  // 6. 短延迟
   delay(10);
 }